@@ -23,4 +23,30 @@ class GenericMotor : public MicroBitComponent
     uint32_t getDutyCyclePeriod(void) const { return dutyCyclePeriod; }
 };
 
+inline void GenericMotor::brake(void) {
+    forward.setDigitalValue(1);
+    reverse.setDigitalValue(1);
+}
+
+inline void GenericMotor::powerSlowDecay(int8_t duty_percent) {
+    int32_t pwmvalue = duty_percent * MICROBIT_PIN_MAX_OUTPUT / 100;
+
+    if (pwmvalue >= MICROBIT_PIN_MAX_OUTPUT) {
+        reverse.setDigitalValue(0);
+    } else if (pwmvalue > 0) {
+        reverse.setAnalogPeriodUs(dutyCyclePeriod);
+        reverse.setAnalogValue(MICROBIT_PIN_MAX_OUTPUT - pwmvalue);
+    } else {
+        reverse.setDigitalValue(1);
+    }
+    if (pwmvalue <= -MICROBIT_PIN_MAX_OUTPUT) {
+        forward.setDigitalValue(0);
+    } else if (pwmvalue < 0) {
+        forward.setAnalogPeriodUs(dutyCyclePeriod);
+        forward.setAnalogValue(MICROBIT_PIN_MAX_OUTPUT + pwmvalue);
+    } else {
+        forward.setDigitalValue(1);
+    }
+}
+
 #endif
@@ -0,0 +1,80 @@
+#include "mbed.h"
+#include "Odometry.h"
+
+// sin(x) for the first quadrant, in Q15.
+static const uint16_t sineTable[65] = {
+        0,   804,  1608,  2411,  3212,  4011,  4808,  5602,
+     6393,  7180,  7962,  8740,  9512, 10279, 11039, 11793,
+    12540, 13279, 14010, 14733, 15447, 16151, 16846, 17531,
+    18205, 18868, 19520, 20160, 20788, 21403, 22006, 22595,
+    23170, 23732, 24279, 24812, 25330, 25833, 26320, 26791,
+    27246, 27684, 28106, 28511, 28899, 29269, 29622, 29957,
+    30274, 30572, 30853, 31114, 31357, 31581, 31786, 31972,
+    32138, 32286, 32413, 32522, 32610, 32679, 32729, 32758,
+    32768,
+};
+
+// Q15 sine of an angle where 2^32 is a full turn, interpolated from the table.
+static int32_t sinQ15(uint32_t angle) {
+    uint32_t phase = angle & 0x3fffffff;
+    if (angle & 0x40000000) phase = 0x40000000 - phase;
+    uint32_t i = phase >> 24;
+    int32_t frac = (phase >> 8) & 0xffff;
+    int32_t a = sineTable[i];
+    int32_t b = i < 64 ? sineTable[i + 1] : a;
+    int32_t s = a + (((b - a) * frac) >> 16);
+    return (angle & 0x80000000) ? -s : s;
+}
+
+static int32_t cosQ15(uint32_t angle) {
+    return sinQ15(angle + 0x40000000);
+}
+
+Odometry::Odometry(MicroBitQuadratureDecoder& left_, MicroBitQuadratureDecoder& right_,
+                   int32_t leftUmPerCount_, int32_t rightUmPerCount_, uint32_t trackWidthUm)
+    : left(left_), right(right_),
+      leftUmPerCount(leftUmPerCount_), rightUmPerCount(rightUmPerCount_),
+      // heading units per micrometre of differential travel, in Q24: 2^32 / (2 pi trackWidthUm)
+      headingScale((int64_t)((1ULL << 56) / 628319 * 100000 / trackWidthUm)) {
+    lastLeft = left.getPosition();
+    lastRight = right.getPosition();
+    reset();
+}
+
+void Odometry::tick(void) {
+    int64_t l = left.getPosition();
+    int64_t r = right.getPosition();
+    int32_t dl = (int32_t)(l - lastLeft) * leftUmPerCount;
+    int32_t dr = (int32_t)(r - lastRight) * rightUmPerCount;
+    lastLeft = l;
+    lastRight = r;
+    if (dl == 0 && dr == 0)
+        return;
+
+    // Advance along the mean of the old and new headings; dl + dr is twice
+    // the distance moved, which with a Q15 direction makes Q16.
+    uint32_t turn = (uint32_t)(((int64_t)(dr - dl) * headingScale) >> 24);
+    uint32_t mid = heading + (uint32_t)((int32_t)turn / 2);
+    x += (int64_t)(dl + dr) * cosQ15(mid);
+    y += (int64_t)(dl + dr) * sinQ15(mid);
+    heading += turn;
+    publish();
+}
+
+void Odometry::publish(void) {
+    Pose p;
+    p.x = (int32_t)(x >> 16);
+    p.y = (int32_t)(y >> 16);
+    p.heading = heading;
+    pose.write(p);
+}
+
+void Odometry::reset(int32_t x, int32_t y, uint32_t heading) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    this->x = (int64_t)x << 16;
+    this->y = (int64_t)y << 16;
+    this->heading = heading;
+    publish();
+    __set_PRIMASK(primask);
+}
@@ -0,0 +1,81 @@
+#include "mbed.h"
+#include "MicroBitQuadratureDecoder.h"
+#include "SeqLock.h"
+
+#ifndef MICROBIT_ODOMETRY_H
+#define MICROBIT_ODOMETRY_H
+
+/**
+  * Dead-reckoning pose for a two-wheel differential drive, integrated in
+  * fixed point from the wheel decoders.
+  *
+  * `tick()` is meant to be listed in a MotorBoard after both wheel motors, so
+  * that it sees every position update at the control loop rate.
+  */
+class Odometry
+{
+    public:
+
+    struct Pose {
+        int32_t x;                      // micrometres
+        int32_t y;                      // micrometres
+        uint32_t heading;               // anticlockwise from the x axis, 2^32 per turn
+    };
+
+    private:
+
+    MicroBitQuadratureDecoder& left;
+    MicroBitQuadratureDecoder& right;
+    const int32_t leftUmPerCount;
+    const int32_t rightUmPerCount;
+    const int64_t headingScale;
+
+    int64_t lastLeft;
+    int64_t lastRight;
+    int64_t x;                          // micrometres, Q16
+    int64_t y;                          // micrometres, Q16
+    uint32_t heading;
+    SeqLock<Pose> pose;
+
+    void publish(void);
+
+    public:
+
+    /**
+      * Constructor.
+      *
+      * @param left_            Decoder on the left wheel.
+      * @param right_           Decoder on the right wheel.
+      * @param leftUmPerCount_  Distance the left wheel travels forward per decoder count, in micrometres.  Negative if the decoder counts down going forward.
+      * @param rightUmPerCount_ As leftUmPerCount_, for the right wheel.
+      * @param trackWidthUm     Distance between the wheels' contact points, in micrometres.
+      *
+      * @code
+      * // 56mm wheels, 720 counts per turn, 120mm apart, left motor mirrored
+      * Odometry odo(qd, qdb, -244, 244, 120000);
+      * @endcode
+      */
+    Odometry(MicroBitQuadratureDecoder& left_, MicroBitQuadratureDecoder& right_,
+             int32_t leftUmPerCount_, int32_t rightUmPerCount_, uint32_t trackWidthUm);
+
+    /**
+      * Integrate wheel movement since the last call.
+      *
+      * Call from the control tick, after both decoders have been polled.
+      */
+    void tick(void);
+
+    /**
+      * Get a consistent copy of the current pose.
+      *
+      * Safe to call from thread context while `tick()` runs in an interrupt.
+      */
+    Pose getPose(void) const { return pose.read(); }
+
+    /**
+      * Set the current pose, for example to zero it at a known start point.
+      */
+    void reset(int32_t x = 0, int32_t y = 0, uint32_t heading = 0);
+};
+
+#endif
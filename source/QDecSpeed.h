@@ -0,0 +1,101 @@
+#include "mbed.h"
+
+#include <limits.h>
+#include <limits>
+#include <type_traits>
+
+#ifndef MICROBIT_QDECSPEED_H
+#define MICROBIT_QDECSPEED_H
+
+// Smallest shift which brings `t` down to no more than `max`.
+constexpr int qdecSpeedTickShift(uint32_t t, uint32_t max) {
+    return t <= max ? 0 : 1 + qdecSpeedTickShift(t >> 1, max);
+}
+
+/**
+  * Moving-window speed estimate over the last `taps` sample intervals.
+  *
+  * Each slot holds the movement and elapsed time since the previous sample,
+  * rather than absolute positions and timestamps, so they fit in a small
+  * `Storage` type.  Totals for the whole window are kept up to date as slots
+  * are replaced.  Elapsed times are stored in units of 2^n microseconds, as
+  * fine as still allows a gap of `taps * 10` sample intervals, with the
+  * remainder carried into the next interval.  A sample which doesn't fit (the
+  * motor moved too far, or updates stalled for longer than that) restarts the
+  * window from that sample.
+  *
+  * With the defaults this is eight taps of 16-bit history, which is good for
+  * +/-32767 counts per 5ms.
+  *
+  * @param taps            Number of intervals averaged, a power of two.  More
+  *                        taps give a smoother but laggier speed, at a cost of
+  *                        2 * sizeof(Storage) bytes each.
+  * @param sampleInterval  Minimum time between samples, in microseconds.
+  * @param Storage         Signed type for the per-interval position change.
+  *                        Elapsed times use the unsigned equivalent.
+  */
+template <int taps = 8, uint32_t sampleInterval = 5000, typename Storage = int16_t>
+class QDecSpeed
+{
+    typedef typename std::make_unsigned<Storage>::type TickStorage;
+
+    static_assert(taps > 0 && taps <= 256 && (taps & (taps - 1)) == 0, "taps must be a power of two no larger than 256");
+    static_assert(std::is_signed<Storage>::value && sizeof(Storage) <= sizeof(int32_t), "Storage must be a signed type no larger than int32_t");
+
+    static const uint32_t windowTimeout = sampleInterval * taps * 10;
+    static const int tickShift = qdecSpeedTickShift(windowTimeout, std::numeric_limits<TickStorage>::max());
+
+    static_assert((sampleInterval >> tickShift) >= 64, "Storage too small to time sampleInterval over the window");
+
+    Storage           positionHistory[taps];
+    TickStorage       tickHistory[taps];
+    uint32_t          lastPosition;
+    uint32_t          lastTick;
+    int32_t           positionDelta;
+    int32_t           timeDelta;
+    uint8_t           windowPos;
+
+    public:
+
+    QDecSpeed(void) { reset(0, 0); }
+
+    void reset(int64_t position, uint32_t tick) {
+        for (int i = 0; i < taps; i++) {
+            positionHistory[i] = 0;
+            tickHistory[i] = 0;
+        }
+        lastPosition = (uint32_t)position;
+        lastTick = tick;
+        windowPos = 0;
+        positionDelta = 0;
+        timeDelta = 0;
+    }
+
+    void update(int64_t position, uint32_t tick) {
+        uint32_t elapsed = tick - lastTick;
+        int32_t moved = (uint32_t)position - lastPosition;
+        if (elapsed > windowTimeout
+                || moved < std::numeric_limits<Storage>::min()
+                || moved > std::numeric_limits<Storage>::max()) reset(position, tick);
+        else if (elapsed >= sampleInterval) {
+            TickStorage ticks = elapsed >> tickShift;
+            windowPos = (windowPos + 1) & (taps - 1);
+            positionDelta += moved - positionHistory[windowPos];
+            timeDelta += (int32_t)ticks - tickHistory[windowPos];
+            positionHistory[windowPos] = moved;
+            tickHistory[windowPos] = ticks;
+            lastPosition = (uint32_t)position;
+            lastTick += (uint32_t)ticks << tickShift;
+        }
+    }
+
+    int32_t getSpeed(void) const {
+        int32_t positionDelta = this->positionDelta;
+        int32_t timeDelta = this->timeDelta;
+        if (timeDelta == 0)
+            return 0;
+        return (1000000LL * positionDelta) / ((int64_t)timeDelta << tickShift);
+    }
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "mbed.h"
+
+#include <atomic>
+
+#ifndef MICROBIT_SEQLOCK_H
+#define MICROBIT_SEQLOCK_H
+
+/**
+  * A value published by one writer and copied out whole by readers which
+  * may be interrupted by it.
+  *
+  * Writes never wait, so they're safe from the control tick.  Reads retry
+  * if a write lands part way through their copy, rather than masking
+  * interrupts.  There must only be one writer at a time: normally the
+  * control tick, or thread context while no tick is running.
+  *
+  * `value` isn't volatile, so each barrier is a compiler fence as well as a
+  * `__DMB()`: older CMSIS headers don't make `__DMB()` clobber memory, and
+  * without the fence the copy could be moved outside the sequence checks.
+  */
+template <class T>
+class SeqLock
+{
+    volatile uint32_t sequence = 0;
+    T value;
+
+    static void barrier(void) {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        __DMB();
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+
+    public:
+
+    void write(T const& v) {
+        sequence = sequence + 1;
+        barrier();
+        value = v;
+        barrier();
+        sequence = sequence + 1;
+    }
+
+    T read(void) const {
+        T v;
+        uint32_t seq;
+        do {
+            seq = sequence;
+            barrier();
+            v = value;
+            barrier();
+        } while ((seq & 1) != 0 || seq != sequence);
+        return v;
+    }
+};
+
+#endif
@@ -71,20 +71,6 @@ void SoftQuadratureDecoder::stop()
     eventBus.ignore(listenId, MICROBIT_PIN_EVT_FALL, this, &SoftQuadratureDecoder::onEdgeEvent);
 }
 
-/** Poll hardware for latest decoder movement and reset the hardware counter to zero.
-  *
-  * This must be called regularly to prevent the hardware from overflowing.
-  * About ten times per second, or less if the attached hardware is
-  * guaranteed to count more slowly than 10000 encoder counts per second.
-  *
-  * This call may be made from systemTick(), or a dedicated motor control ticker interrupt.
-  */
-void SoftQuadratureDecoder::poll()
-{
-    int32_t current = countstate ^ phaseB.getDigitalValue();
-    position += current - (int32_t)position;
-}
-
 /**
   * Reset the position to a known value.
   *
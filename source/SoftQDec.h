@@ -110,4 +110,10 @@ class SoftQuadratureDecoder : public MicroBitQuadratureDecoder
     virtual void resetPosition(int64_t position = 0) override;
 };
 
+inline void SoftQuadratureDecoder::poll()
+{
+    int32_t current = countstate ^ phaseB.getDigitalValue();
+    position += current - (int32_t)position;
+}
+
 #endif
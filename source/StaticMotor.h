@@ -0,0 +1,133 @@
+#include "mbed.h"
+#include "MicroBitQuadratureDecoder.h"
+#include "GenericMotor.h"
+#include "QDecSpeed.h"
+#include "TachoMotor.h"
+
+#ifndef MICROBIT_STATICMOTOR_H
+#define MICROBIT_STATICMOTOR_H
+
+/**
+  * Non-virtual access to a decoder whose concrete type is known at compile
+  * time.
+  */
+template <class QDec>
+class StaticDecoder
+{
+    QDec& qdec;
+
+    public:
+
+    StaticDecoder(QDec& qd) : qdec(qd) {}
+
+    int start(void) { return qdec.QDec::start(); }
+    void stop(void) { qdec.QDec::stop(); }
+    TACHOMOTOR_ALWAYS_INLINE void poll(void) { qdec.QDec::poll(); }
+    TACHOMOTOR_ALWAYS_INLINE int64_t getPosition(void) const { return qdec.getPosition(); }
+};
+
+/**
+  * Non-virtual access to a motor driver whose concrete type is known at
+  * compile time.
+  */
+template <class Motor>
+class StaticDriver
+{
+    Motor& motor;
+
+    public:
+
+    StaticDriver(Motor& mtr) : motor(mtr) {}
+
+    void sleep(void) { motor.Motor::sleep(); }
+    void brake(void) { motor.Motor::brake(); }
+    void coast(void) { motor.Motor::coast(); }
+    void powerFastDecay(int8_t duty_percent) { motor.Motor::powerFastDecay(duty_percent); }
+    TACHOMOTOR_ALWAYS_INLINE void powerSlowDecay(int8_t duty_percent) { motor.Motor::powerSlowDecay(duty_percent); }
+};
+
+/**
+  * TachoMotor with everything bound at compile time and no ticker of its own.
+  *
+  * `tick()` must be called at `pollPeriod` intervals, normally by listing the
+  * motor in a MotorBoard.
+  *
+  * @code
+  * typedef StaticTachoMotor<SoftQuadratureDecoder, GenericMotor, QDecSpeed<4> > MotorB;
+  * MotorB tmotb(12345, motorb, qdb);
+  * MotorBoard<MotorB> board(tmotb);
+  * @endcode
+  */
+template <class QDec, class Motor, class Speed = QDecSpeed<> >
+class StaticTachoMotor final
+    : public BasicTachoMotor<StaticTachoMotor<QDec, Motor, Speed>, StaticDecoder<QDec>, StaticDriver<Motor>, Speed>
+{
+    typedef BasicTachoMotor<StaticTachoMotor<QDec, Motor, Speed>, StaticDecoder<QDec>, StaticDriver<Motor>, Speed> Base;
+
+    public:
+
+    StaticTachoMotor(uint16_t id, Motor& mtr, QDec& qd)
+        : Base(id, mtr, qd, Speed()) {}
+
+    void tick(void) {
+        if (this->state != this->MOTOR_SLEEP)
+            this->pidTick();
+    }
+};
+
+template <class... Components>
+class ComponentList;
+
+template <>
+class ComponentList<>
+{
+    public:
+
+    void tick(void) {}
+};
+
+template <class Component, class... Rest>
+class ComponentList<Component, Rest...> : ComponentList<Rest...>
+{
+    Component& component;
+
+    public:
+
+    ComponentList(Component& c, Rest&... rest) : ComponentList<Rest...>(rest...), component(c) {}
+
+    void tick(void) {
+        component.tick();
+        ComponentList<Rest...>::tick();
+    }
+};
+
+/**
+  * A board descriptor: the fixed set of components serviced by one control
+  * ticker.
+  *
+  * Each component's `tick()` is called in the order listed, all from one
+  * interrupt, and with the types known here the whole sequence can be
+  * inlined.
+  *
+  * @code
+  * MotorBoard<MotorA, MotorB> board(tmot, tmotb);
+  * board.start();
+  * @endcode
+  */
+template <class... Components>
+class MotorBoard
+{
+    ComponentList<Components...> components;
+    Ticker ticker;
+
+    public:
+
+    MotorBoard(Components&... c) : components(c...) {}
+
+    void start(void) { ticker.attach_us(this, &MotorBoard::tick, TachoMotorCommon::pollPeriod); }
+    void stop(void) { ticker.detach(); }
+
+    void tick(void) { components.tick(); }
+};
+
+#endif
@@ -2,41 +2,33 @@
 #include "MicroBitPin.h"
 #include "MicroBitQuadratureDecoder.h"
 #include "GenericMotor.h"
+#include "QDecSpeed.h"
+#include "SeqLock.h"
+#include "ErrorNo.h"
 
 #include <limits.h>
 
 #ifndef MICROBIT_TACHOMOTOR_H
 #define MICROBIT_TACHOMOTOR_H
 
-class QDecSpeed
-{
-    static const int  taps = 8;
-    int64_t           positionHistory[taps];
-    uint32_t          tickHistory[taps];
-    const uint32_t    sampleInterval = 5000;
-    int32_t           positionDelta;
-    int32_t           timeDelta;
-    uint8_t           windowPos;
-
-    public:
+// For helpers run every control tick, so they still inline into pidTick()
+// when the build optimises for size.
+#define TACHOMOTOR_ALWAYS_INLINE inline __attribute__((always_inline))
 
-    void reset(int64_t position, uint32_t tick);
-    void update(int64_t position, uint32_t tick);
-    int32_t getSpeed(void) const;
-};
-
-class TachoMotor : public MicroBitComponent
+/**
+  * Control state and tuning common to every TachoMotor, however its decoder,
+  * driver and speed estimate are bound.
+  */
+class TachoMotorCommon : public MicroBitComponent
 {
-    static const int pollPeriod = 2000;
-    static const int hysteresis = 3;
+    protected:
 
-    GenericMotor& motor;
-    MicroBitQuadratureDecoder& qdec;
-    QDecSpeed speed;
-    Ticker ticker;
+    static const int hysteresis = 3;
 
     public:
 
+    static const int pollPeriod = 2000;
+
     enum Mode {
         MOTOR_SLEEP = 0,
         MOTOR_COAST,
@@ -44,17 +36,29 @@ class TachoMotor : public MicroBitComponent
         MOTOR_POWER,                    // set specific power
         MOTOR_SPEED,                    // set specific speed
         MOTOR_TRACK,                    // follow constantly-changing position
-        MOTOR_POSITION                  // active feedback to maintain position
+        MOTOR_POSITION,                 // active feedback to maintain position
+        MOTOR_GEAR                      // follow another decoder through a ratio
     };
 
-    TachoMotor(uint16_t id, GenericMotor& mtr, MicroBitQuadratureDecoder& qd)
-        : motor(mtr), qdec(qd) { this->id = id; }
-
-    protected:
+    /**
+      * Everything worth displaying about the motor, as at the end of one
+      * control tick.
+      */
+    struct Snapshot {
+        int64_t position;
+        int64_t target;
+        int32_t speed;
+        int32_t targetSpeed;
+        int32_t error;
+        int32_t sigma;                  // saturated to fit
+        int32_t delta;
+        Mode mode;
+        int8_t duty;
+    };
 
-    int start(void);
+    static char const* modeName(Mode mode);
 
-    void stop(void);
+    protected:
 
     struct PIDState {
         int32_t error;
@@ -67,26 +71,66 @@ class TachoMotor : public MicroBitComponent
             delta = 0;
         }
 
-        void update(int64_t target, int64_t current);
-        int32_t output(int32_t p, int32_t i, int32_t d) const;
+        TACHOMOTOR_ALWAYS_INLINE void update(int64_t target, int64_t current) {
+            int32_t oldError = error;
+            error = target - current;
+            if (-hysteresis < error && error < hysteresis) error = 0;
+            sigma += error;
+            delta = error - oldError;
+        }
+
+        TACHOMOTOR_ALWAYS_INLINE int32_t output(int32_t p, int32_t i, int32_t d) const {
+            int64_t sum = (int64_t)p * error;
+            sum += (int64_t)i * sigma;
+            sum += (int64_t)d * delta;
+            sum >>= 16;
+            if (sum < INT_MIN) return INT_MIN;
+            if (sum > INT_MAX) return INT_MAX;
+            return (int32_t)sum;
+        }
     };
 
-    private:
+    struct GearState {
+        MicroBitQuadratureDecoder* source;
+        int32_t numerator;
+        int32_t denominator;
+        int64_t offset;                 // requested phase
+        int64_t phase;                  // phase currently applied
+        int32_t phaseSlew;
+        int32_t maxError;
+
+        // Rounded down rather than toward zero, so that every output step is
+        // the same width, including the one around zero.
+        TACHOMOTOR_ALWAYS_INLINE int64_t geared(void) const {
+            int64_t scaled = source->getPosition() * numerator;
+            int64_t q = scaled / denominator;
+            return scaled % denominator < 0 ? q - 1 : q;
+        }
+
+        void reset(int64_t current) {
+            phase = phaseSlew > 0 ? current - geared() : offset;
+        }
+
+        TACHOMOTOR_ALWAYS_INLINE int64_t target(void) {
+            if (phase < offset) {
+                phase = (offset - phase > phaseSlew) ? phase + phaseSlew : offset;
+            } else if (phase > offset) {
+                phase = (phase - offset > phaseSlew) ? phase - phaseSlew : offset;
+            }
+            return geared() + phase;
+        }
+    };
 
     Mode state = MOTOR_SLEEP;
     Mode nextState = MOTOR_SLEEP;
     int64_t targetPosition;
     int32_t targetSpeed;
     PIDState pid;
+    GearState gear;
     int8_t duty;
+    SeqLock<Snapshot> snapshot;
 
-    void setState(Mode s);
-    void setNextState(int64_t where, Mode s);
-    virtual void pidTick(void);
-
-    protected:
-    virtual int followSpeed(PIDState& pid, int8_t duty) const;
-    virtual int followPosition(PIDState& pid, int8_t duty) const;
+    TACHOMOTOR_ALWAYS_INLINE void publish(int64_t position, int32_t speed);
 
     public:
     int32_t speedP = 1576;
@@ -96,6 +140,76 @@ class TachoMotor : public MicroBitComponent
     int32_t positionI = 0;
     int32_t positionD = 0;
 
+    /**
+      * Get a coherent copy of the state as of the last control tick.
+      *
+      * Safe to call from thread context without holding off the control
+      * tick.
+      */
+    Snapshot getSnapshot(void) const { return snapshot.read(); }
+
+#if 1 /* debug fluff */
+    void peek(int64_t& target, int32_t& speed, int8_t& duty, char const*& mode) const {
+        Snapshot snap = getSnapshot();
+        target = snap.target;
+        speed = snap.targetSpeed;
+        duty = snap.duty;
+        mode = modeName(snap.mode);
+    }
+    void pidpeek(int32_t& e, int32_t& s, int32_t& d) const {
+        Snapshot snap = getSnapshot();
+        e = snap.error;
+        s = snap.sigma;
+        d = snap.delta;
+    }
+    int64_t triggerPosition = 0;
+#endif
+};
+
+/**
+  * Motor control logic, with its decoder, driver and speed estimate bound at
+  * compile time.
+  *
+  * `start()`, `stop()`, `followSpeed()` and `followPosition()` are looked up
+  * on `Derived` (which must befriend this class if it overrides them) and
+  * called directly rather than through a vtable.  When all the types are
+  * concrete, and their per-tick methods are defined in headers, `pidTick()`
+  * compiles to one function with no indirect calls.
+  *
+  * @param Derived  The class deriving from this one.
+  * @param Decoder  Provides `start()`, `stop()`, `poll()` and `getPosition()`;
+  *                 may be a reference type.
+  * @param Driver   Provides the GenericMotor power controls; may be a
+  *                 reference type.
+  * @param Speed    A QDecSpeed.
+  */
+template <class Derived, class Decoder, class Driver, class Speed>
+class BasicTachoMotor : public TachoMotorCommon
+{
+    Derived& self(void) { return *static_cast<Derived*>(this); }
+
+    protected:
+
+    Driver motor;
+    Decoder qdec;
+    Speed speed;
+
+    BasicTachoMotor(uint16_t id, Driver mtr, Decoder qd, Speed sp)
+        : motor(mtr), qdec(qd), speed(sp) { this->id = id; }
+
+    int start(void) { return qdec.start(); }
+
+    void stop(void) { qdec.stop(); }
+
+    void setState(Mode s);
+    void setNextState(int64_t where, Mode s);
+    void pidTick(void);
+
+    TACHOMOTOR_ALWAYS_INLINE int followSpeed(PIDState& pid, int8_t duty) const;
+    TACHOMOTOR_ALWAYS_INLINE int followPosition(PIDState& pid, int8_t duty) const;
+
+    public:
+
     void goTo(int64_t target, Mode andThen = MOTOR_BRAKE);
     void sleep(void) { setState(MOTOR_SLEEP); }
     void coast(void) { setState(MOTOR_COAST); }
@@ -108,6 +222,8 @@ class TachoMotor : public MicroBitComponent
         targetSpeed = speed;
         setState(MOTOR_SPEED);
     }
+    int gearTo(MicroBitQuadratureDecoder& source, int32_t numerator, int32_t denominator = 1,
+                int64_t offset = 0, int32_t phaseSlew = 0, int32_t maxError = 0);
 
     int64_t getPosition(void) { return qdec.getPosition(); }
     int64_t getSpeed(void) { return speed.getSpeed(); }
@@ -115,30 +231,239 @@ class TachoMotor : public MicroBitComponent
 
     int64_t getPosition(void) const { return qdec.getPosition(); }
     int64_t getSpeed(void) const { return speed.getSpeed(); }
+};
 
-#if 1 /* debug fluff */
-    void peek(int64_t& target, int32_t& speed, int8_t& duty, char const*& mode) {
-        target = targetPosition;
-        speed = targetSpeed;
-        duty = this->duty;
-        switch (state) {
-        case MOTOR_SLEEP:     mode = "SLEEP"; break;
-        case MOTOR_COAST:     mode = "COAST"; break;
-        case MOTOR_BRAKE:     mode = "BRAKE"; break;
-        case MOTOR_POWER:     mode = "POWER"; break;
-        case MOTOR_SPEED:     mode = "SPEED"; break;
-        case MOTOR_TRACK:     mode = "TRACK"; break;
-        case MOTOR_POSITION:  mode = "POSITION"; break;
-        default:              mode = "???";
+/**
+  * TachoMotor for dynamic use, driving any GenericMotor from any decoder,
+  * with its own control ticker.
+  *
+  * @param Speed    The QDecSpeed window for this motor.
+  */
+template <class Speed = QDecSpeed<> >
+class TachoMotor : public BasicTachoMotor<TachoMotor<Speed>, MicroBitQuadratureDecoder&, GenericMotor&, Speed>
+{
+    typedef BasicTachoMotor<TachoMotor<Speed>, MicroBitQuadratureDecoder&, GenericMotor&, Speed> Base;
+    friend Base;
+
+    typedef TachoMotorCommon::PIDState PIDState;
+
+    Ticker ticker;
+
+    public:
+
+    TachoMotor(uint16_t id, GenericMotor& mtr, MicroBitQuadratureDecoder& qd)
+        : Base(id, mtr, qd, Speed()) {}
+
+    protected:
+
+    int start(void);
+
+    void stop(void);
+
+    private:
+
+    virtual void pidTick(void) { Base::pidTick(); }
+
+    protected:
+    virtual int followSpeed(PIDState& pid, int8_t duty) const;
+    virtual int followPosition(PIDState& pid, int8_t duty) const;
+};
+
+template <class Speed>
+int TachoMotor<Speed>::start(void) {
+    int result = this->qdec.start();
+    if (result == MICROBIT_OK)
+        ticker.attach_us(this, &TachoMotor::pidTick, this->pollPeriod);
+    return result;
+}
+
+template <class Speed>
+void TachoMotor<Speed>::stop(void) {
+    ticker.detach();
+    this->qdec.stop();
+}
+
+template <class Speed>
+int TachoMotor<Speed>::followSpeed(PIDState& pid, int8_t duty) const {
+    return Base::followSpeed(pid, duty);
+}
+
+template <class Speed>
+int TachoMotor<Speed>::followPosition(PIDState& pid, int8_t duty) const {
+    return Base::followPosition(pid, duty);
+}
+
+inline void TachoMotorCommon::publish(int64_t position, int32_t speed) {
+    Snapshot snap;
+    snap.position = position;
+    snap.target = targetPosition;
+    snap.speed = speed;
+    snap.targetSpeed = targetSpeed;
+    snap.error = pid.error;
+    snap.sigma = pid.sigma < INT_MIN ? INT_MIN : pid.sigma > INT_MAX ? INT_MAX : (int32_t)pid.sigma;
+    snap.delta = pid.delta;
+    snap.mode = state;
+    snap.duty = duty;
+    snapshot.write(snap);
+}
+
+template <class Derived, class Decoder, class Driver, class Speed>
+void BasicTachoMotor<Derived, Decoder, Driver, Speed>::setState(Mode s) {
+    Mode oldState = state;
+    nextState = state = s;
+    if (oldState == MOTOR_SLEEP && state != MOTOR_SLEEP)
+        self().start();
+    switch (s) {
+    case MOTOR_SLEEP:
+        if (oldState != MOTOR_SLEEP) {
+            duty = 0;
+            motor.sleep();
+            self().stop();
+        }
+        break;
+    case MOTOR_COAST:
+        duty = 0;
+        motor.coast();
+        break;
+    case MOTOR_BRAKE:
+        duty = 0;
+        motor.brake();
+        break;
+    case MOTOR_POWER:
+        motor.powerSlowDecay(duty);
+        break;
+    case MOTOR_SPEED:
+    case MOTOR_TRACK:
+        if (oldState != state)
+            pid.reset();
+        break;
+    case MOTOR_POSITION:
+        motor.brake();
+        pid.reset();
+        break;
+    case MOTOR_GEAR:
+        if (oldState != state)
+            pid.reset();
+        break;
+    }
+    state = s;
+    if (state == MOTOR_SLEEP)
+        publish(qdec.getPosition(), speed.getSpeed());
+}
+
+template <class Derived, class Decoder, class Driver, class Speed>
+void BasicTachoMotor<Derived, Decoder, Driver, Speed>::setNextState(int64_t where, Mode s) {
+    targetPosition = where;
+    nextState = s;
+}
+
+template <class Derived, class Decoder, class Driver, class Speed>
+void BasicTachoMotor<Derived, Decoder, Driver, Speed>::pidTick(void) {
+    qdec.poll();
+    int64_t p = qdec.getPosition();
+    speed.update(p, us_ticker_read());
+    int32_t q = speed.getSpeed();
+    if (state != nextState) {
+        if ((duty > 0 && p >= targetPosition) || (duty < 0 && p <= targetPosition)) {
+            triggerPosition = p;
+            setState(nextState);
         }
     }
-    void pidpeek(int32_t& e, int32_t& s, int32_t& d) {
-        e = pid.error;
-        s = pid.sigma;
-        d = pid.delta;
+    switch (state) {
+    case MOTOR_SPEED:
+        pid.update(targetSpeed, q);
+        duty = self().followSpeed(pid, duty);
+        motor.powerSlowDecay(duty);
+        break;
+    case MOTOR_TRACK:
+        pid.update(targetPosition, p);
+        duty = self().followPosition(pid, duty);
+        motor.powerSlowDecay(duty);
+        break;
+    case MOTOR_POSITION:
+        pid.update(targetPosition, p);
+        duty = self().followPosition(pid, duty);
+        motor.powerSlowDecay(duty);
+        break;
+    case MOTOR_GEAR:
+        targetPosition = gear.target();
+        if (gear.maxError > 0 && (targetPosition - p > gear.maxError || p - targetPosition > gear.maxError)) {
+            triggerPosition = p;
+            setState(MOTOR_BRAKE);
+            break;
+        }
+        pid.update(targetPosition, p);
+        duty = self().followPosition(pid, duty);
+        motor.powerSlowDecay(duty);
+        break;
+    default:
+        /* no-op */
+        break;
     }
-    int64_t triggerPosition = 0;
-#endif
-};
+    publish(p, q);
+}
+
+template <class Derived, class Decoder, class Driver, class Speed>
+int BasicTachoMotor<Derived, Decoder, Driver, Speed>::followSpeed(PIDState& pid, int8_t) const {
+    return pid.output(speedP, speedI, speedD);
+}
+
+template <class Derived, class Decoder, class Driver, class Speed>
+int BasicTachoMotor<Derived, Decoder, Driver, Speed>::followPosition(PIDState& pid, int8_t) const {
+    return pid.output(positionP, positionI, positionD);
+}
+
+template <class Derived, class Decoder, class Driver, class Speed>
+void BasicTachoMotor<Derived, Decoder, Driver, Speed>::goTo(int64_t target, Mode andThen) {
+    int64_t p = qdec.getPosition();
+    if (p < target) {
+        go(100);
+    } else if (target < p) {
+        go(-100);
+    }
+    setNextState(target, andThen);
+}
+
+/**
+  * Slave this motor to another decoder, so that every tick its target
+  * position becomes `source * numerator / denominator + offset`.
+  *
+  * The source must be kept polled by something else, such as its own motor
+  * listed earlier in the same MotorBoard.
+  *
+  * @param phaseSlew  If zero, the target jumps straight to the geared
+  *                   position.  Otherwise gearing starts from wherever this
+  *                   motor is now, and the offset is pulled in to the one
+  *                   requested by at most this many counts per tick.
+  * @param maxError   If nonzero, brake when the motor falls more than this
+  *                   many counts behind (or ahead of) its target.
+  *
+  * @return MICROBIT_OK on success, or MICROBIT_INVALID_PARAMETER if the denominator is not positive.
+  */
+template <class Derived, class Decoder, class Driver, class Speed>
+int BasicTachoMotor<Derived, Decoder, Driver, Speed>::gearTo(MicroBitQuadratureDecoder& source,
+            int32_t numerator, int32_t denominator, int64_t offset, int32_t phaseSlew, int32_t maxError) {
+    if (denominator <= 0)
+        return MICROBIT_INVALID_PARAMETER;
+    GearState g;
+    g.source = &source;
+    g.numerator = numerator;
+    g.denominator = denominator;
+    g.offset = offset;
+    g.phaseSlew = phaseSlew;
+    g.maxError = maxError;
+
+    // The tick may already be gearing from the old parameters, so swap in
+    // the new set, with its phase, all at once.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    g.reset(qdec.getPosition());
+    gear = g;
+    __set_PRIMASK(primask);
+
+    if (state != MOTOR_GEAR)
+        setState(MOTOR_GEAR);
+    return MICROBIT_OK;
+}
 
 #endif
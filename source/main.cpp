@@ -2,9 +2,14 @@
 #include "MicroBitSerial.h"
 #include "MicroBitPin.h"
 #include "TachoMotor.h"
+#include "StaticMotor.h"
 #include "SoftQDec.h"
+#include "Odometry.h"
 #include "ErrorNo.h"
 
+// Both motors fully inlined on one control tick, rather than a ticker each
+#define STATIC_MOTORS 1
+
 MicroBitSerial serial(USBTX, USBRX);
 
 MicroBitMessageBus bus;
@@ -30,8 +35,18 @@ GenericMotor motor(P15, P16);
 SoftQuadratureDecoder qdb(MICROBIT_ID_IO_P2, bus, P2, P8);
 GenericMotor motorb(P13, P14);
 #endif
-TachoMotor tmot(12345, motor, qd);
-TachoMotor tmotb(12345, motorb, qdb);
+#if STATIC_MOTORS
+typedef StaticTachoMotor<MicroBitQuadratureDecoder, GenericMotor> MotorA;
+typedef StaticTachoMotor<SoftQuadratureDecoder, GenericMotor, QDecSpeed<4> > MotorB;
+MotorA tmot(12345, motor, qd);
+MotorB tmotb(12345, motorb, qdb);
+// 56mm wheels, 720 counts per turn, 120mm apart, motor A mirrored on the left
+Odometry odo(qd, qdb, -244, 244, 120000);
+MotorBoard<MotorA, MotorB, Odometry> board(tmot, tmotb, odo);
+#else
+TachoMotor<> tmot(12345, motor, qd);
+TachoMotor<QDecSpeed<4> > tmotb(12345, motorb, qdb);
+#endif
 
 int main()
 {
@@ -46,6 +61,10 @@ int main()
     P8.getDigitalValue(PullNone);
     P11.getDigitalValue(PullNone);
 
+#if STATIC_MOTORS
+    board.start();
+#endif
+
     for (;;)
     {
         int key;
@@ -84,6 +103,12 @@ int main()
             case '9': command = "goTo(720, POSITION)";
                 tmot.goTo(720, tmot.MOTOR_POSITION);
                 break;
+            case 'g': command = "tmotb.gearTo(qd, 1:1)";
+                tmotb.gearTo(qd, 1, 1, 0, 4, 360);
+                break;
+            case 'G': command = "tmotb.sleep()";
+                tmotb.sleep();
+                break;
             case 'P':
                 tmot.positionP -= pstep;
                 break;
@@ -102,18 +127,15 @@ int main()
             case 'd':
                 tmot.positionD += dstep;
                 break;
+#if STATIC_MOTORS
+            case 'z':
+                odo.reset();
+                break;
+#endif
             }
         }
 
-        int64_t target;
-        int32_t tspeed;
-        int8_t power;
-        char const* mode;
-        int64_t position = tmot.getPosition();
-        int32_t speed = tmot.getSpeed();
-        int32_t error, sigma, delta;
-        tmot.peek(target, tspeed, power, mode);
-        tmot.pidpeek(error, sigma, delta);
+        TachoMotorCommon::Snapshot snap = tmot.getSnapshot();
         printf("\033[1;1H%s\033[K\r\n"
                 "position: %6d       speed: %5d      error: %6d        mode: %s  \033[K\r\n"
                 "  target: %6d      target: %5d      sigma: %6d       power: %5d  \033[K\r\n"
@@ -122,11 +144,17 @@ int main()
                 "\033[K\r\n"
                 "    posP: %8d    posI: %8d    posD: %8d  \033[K\r\n\033[K\r\n",
                 command,
-                (int)position, (int)speed, (int)error, mode,
-                (int)target, (int)tspeed, (int)sigma, power,
-                (int)(position - target), (int)(speed - tspeed), (int)delta,
+                (int)snap.position, (int)snap.speed, (int)snap.error, tmot.modeName(snap.mode),
+                (int)snap.target, (int)snap.targetSpeed, (int)snap.sigma, snap.duty,
+                (int)(snap.position - snap.target), (int)(snap.speed - snap.targetSpeed), (int)snap.delta,
                 (int)tmot.triggerPosition,
                 (int)tmot.positionP, (int)tmot.positionI, (int)tmot.positionD);
+#if STATIC_MOTORS
+        Odometry::Pose pose = odo.getPose();
+        printf("       x: %6d           y: %6d   heading: %5d  \033[K\r\n",
+                (int)(pose.x / 1000), (int)(pose.y / 1000),
+                (int)(((uint64_t)pose.heading * 360) >> 32));
+#endif
         wait_ms(49);
     }
 }